@@ -1,16 +1,209 @@
 #pragma once
-#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "errors.hpp"
+#include "reclaimer.hpp"
 
 template<typename T>
 class NAryTree {
 public:
+    // Nodes are readable from outside, but links must only change through
+    // NAryTree's methods: the tree keeps node counts per level, and a child
+    // linked or unlinked by hand puts them out of sync. Erasing such a
+    // subtree is then reported as error 12 rather than corrupting memory.
     struct Node {
         T value; 
         std::vector<Node*> children;
         Node(const T& v, std::size_t n) : value(v), children(n, nullptr) {}
-        ~Node() { for (Node* c : children) delete c; }
+        ~Node() {
+            std::vector<Node*> stack;
+            for (Node* c : children) if (c) stack.push_back(c);
+            while (!stack.empty()) {
+                Node* n = stack.back(); stack.pop_back();
+                for (Node* c : n->children) if (c) stack.push_back(c);
+                n->children.clear();
+                delete n;
+            }
+        }
+    };
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // What the traversal iterators yield: the node, its level (root = 0)
+    // and the child indices leading to it from the root.
+    // The iterators keep the current Visit inside themselves and rewrite it
+    // on every ++ to avoid copying the path, so two equal copies refer to
+    // different Visit objects. They are therefore input iterators.
+    // Algorithms that need forward iterators, e.g. the execution-policy
+    // overloads, should run over a vector of nodes collected in one pass.
+    struct Visit {
+        Node* node = nullptr;
+        std::size_t depth = 0;
+        std::vector<std::size_t> path;
+    };
+
+    class PreorderIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Visit;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Visit*;
+        using reference = const Visit&;
+
+        PreorderIterator() = default;
+        // Nodes deeper than maxDepth are neither yielded nor descended into.
+        explicit PreorderIterator(Node* root, std::size_t maxDepth = npos)
+            : maxDepth_(maxDepth) {
+            if (root) {
+                stack_.push_back({root, 0});
+                cur_.node = root;
+            }
+        }
+
+        reference operator*() const { return cur_; }
+        pointer operator->() const { return &cur_; }
+
+        PreorderIterator& operator++() {
+            while (!stack_.empty()) {
+                Frame& f = stack_.back();
+                const auto& ch = f.node->children;
+                if (stack_.size() > maxDepth_) f.next = ch.size();
+                while (f.next < ch.size() && !ch[f.next]) ++f.next;
+                if (f.next < ch.size()) {
+                    std::size_t k = f.next++;
+                    cur_.path.push_back(k);
+                    stack_.push_back({ch[k], 0});
+                    cur_.node = ch[k];
+                    cur_.depth = stack_.size() - 1;
+                    return *this;
+                }
+                stack_.pop_back();
+                if (!cur_.path.empty()) cur_.path.pop_back();
+            }
+            cur_ = Visit{};
+            return *this;
+        }
+        PreorderIterator operator++(int) { auto t = *this; ++*this; return t; }
+
+        bool operator==(const PreorderIterator& o) const { return cur_.node == o.cur_.node; }
+        bool operator!=(const PreorderIterator& o) const { return !(*this == o); }
+
+    private:
+        struct Frame { Node* node; std::size_t next; };
+        std::vector<Frame> stack_;
+        Visit cur_;
+        std::size_t maxDepth_ = npos;
+    };
+
+    class PostorderIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Visit;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Visit*;
+        using reference = const Visit&;
+
+        PostorderIterator() = default;
+        explicit PostorderIterator(Node* root) {
+            if (root) {
+                stack_.push_back({root, 0});
+                descend();
+            }
+        }
+
+        reference operator*() const { return cur_; }
+        pointer operator->() const { return &cur_; }
+
+        PostorderIterator& operator++() {
+            stack_.pop_back();
+            if (!cur_.path.empty()) cur_.path.pop_back();
+            if (stack_.empty()) cur_ = Visit{};
+            else descend();
+            return *this;
+        }
+        PostorderIterator operator++(int) { auto t = *this; ++*this; return t; }
+
+        bool operator==(const PostorderIterator& o) const { return cur_.node == o.cur_.node; }
+        bool operator!=(const PostorderIterator& o) const { return !(*this == o); }
+
+    private:
+        struct Frame { Node* node; std::size_t next; };
+        std::vector<Frame> stack_;
+        Visit cur_;
+
+        // Walks down to the leftmost not yet visited leaf below the top frame.
+        void descend() {
+            while (true) {
+                Frame& f = stack_.back();
+                const auto& ch = f.node->children;
+                while (f.next < ch.size() && !ch[f.next]) ++f.next;
+                if (f.next == ch.size()) break;
+                std::size_t k = f.next++;
+                cur_.path.push_back(k);
+                stack_.push_back({ch[k], 0});
+            }
+            cur_.node = stack_.back().node;
+            cur_.depth = stack_.size() - 1;
+        }
+    };
+
+    class LevelOrderIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Visit;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Visit*;
+        using reference = const Visit&;
+
+        LevelOrderIterator() = default;
+        LevelOrderIterator(Node* root, bool withPaths) : paths_(withPaths) {
+            if (root) queue_.push_back({root, 0, {}});
+            load();
+        }
+
+        reference operator*() const { return cur_; }
+        pointer operator->() const { return &cur_; }
+
+        LevelOrderIterator& operator++() { load(); return *this; }
+        LevelOrderIterator operator++(int) { auto t = *this; ++*this; return t; }
+
+        bool operator==(const LevelOrderIterator& o) const { return cur_.node == o.cur_.node; }
+        bool operator!=(const LevelOrderIterator& o) const { return !(*this == o); }
+
+    private:
+        std::deque<Visit> queue_;
+        Visit cur_;
+        bool paths_ = false;
+
+        void load() {
+            if (queue_.empty()) { cur_ = Visit{}; return; }
+            cur_ = std::move(queue_.front());
+            queue_.pop_front();
+            const auto& ch = cur_.node->children;
+            for (std::size_t k = 0; k < ch.size(); ++k) {
+                if (!ch[k]) continue;
+                Visit v{ch[k], cur_.depth + 1, {}};
+                if (paths_) {
+                    v.path = cur_.path;
+                    v.path.push_back(k);
+                }
+                queue_.push_back(std::move(v));
+            }
+        }
+    };
+
+    template<typename It>
+    struct Range {
+        It first, last;
+        It begin() const { return first; }
+        It end() const { return last; }
     };
 
     explicit NAryTree(std::size_t n) : max_children_(n) {
@@ -18,7 +211,41 @@ public:
             throw MyException(ErrorType::NegativeSize, 2);
         }
     }
-    ~NAryTree() { delete root_; }
+    ~NAryTree() { release(root_); }
+
+    NAryTree(const NAryTree&) = delete;
+    NAryTree& operator=(const NAryTree&) = delete;
+
+    NAryTree(NAryTree&& o) noexcept
+        : root_(o.root_), max_children_(o.max_children_),
+          levels_(std::move(o.levels_)), size_(o.size_),
+          pending_(std::move(o.pending_)), background_(o.background_) {
+        o.root_ = nullptr;
+        o.levels_.clear();
+        o.size_ = 0;
+        o.pending_.clear();
+    }
+    NAryTree& operator=(NAryTree&& o) noexcept {
+        if (this != &o) {
+            release(root_);
+            root_ = o.root_;
+            max_children_ = o.max_children_;
+            levels_ = std::move(o.levels_);
+            size_ = o.size_;
+            pending_ = std::move(o.pending_);
+            background_ = o.background_;
+            o.root_ = nullptr;
+            o.levels_.clear();
+            o.size_ = 0;
+            o.pending_.clear();
+        }
+        return *this;
+    }
+
+    // When enabled, erase/clear/destruction hand detached subtrees to the
+    // background Reclaimer instead of freeing them on the calling thread.
+    void setBackgroundReclaim(bool on) { background_ = on; }
+    bool backgroundReclaim() const { return background_; }
 
 
     void insert(const std::vector<std::size_t>& path, const T& v)
@@ -26,7 +253,7 @@ public:
         if (path.empty()) {
             if (root_) throw MyException(ErrorType::InvalidArg, 6);
             root_  = new Node(v, max_children_);
-            height_ = 1;
+            added(0);
             return;
         }
 
@@ -49,7 +276,19 @@ public:
             throw MyException(ErrorType::InvalidArg, 7);
         }
         cur->children[last] = new Node(v, max_children_);
-        height_ = std::max<std::size_t>(height_, path.size() + 1);
+        added(path.size());
+    }
+
+    // O(1) insertion for builders that already hold the parent node;
+    // parentLevel is the parent's level (root = 0).
+    Node* insertChild(Node* parent, std::size_t parentLevel, std::size_t k, const T& v)
+    {
+        if (!parent || parentLevel >= levels_.size()) throw MyException(ErrorType::OutOfRange, 8);
+        if (k >= max_children_) throw MyException(ErrorType::OutOfRange, 3);
+        if (parent->children[k]) throw MyException(ErrorType::InvalidArg, 7);
+        parent->children[k] = new Node(v, max_children_);
+        added(parentLevel + 1);
+        return parent->children[k];
     }
 
     Node* find(const std::vector<std::size_t>& path) const {
@@ -63,31 +302,53 @@ public:
         return cur;
     }
 
+    // Unlinks the subtree at path and returns it; the caller owns it.
+    // Counting the removed nodes walks the subtree on this thread.
+    Node* detach(const std::vector<std::size_t>& path) {
+        std::size_t level = 0;
+        Node* n = unlink(path, level);
+        if (n && level) settleRemoved(n, level);
+        return n;
+    }
+
+    // With background reclaim on, erase is O(path length): both counting
+    // the removed nodes and freeing them happen on the Reclaimer, and the
+    // counts are folded into the tree by settle(). The count is an urgent
+    // job, so it does not queue behind frees of other trees.
     void erase(const std::vector<std::size_t>& path) {
-        if (!root_) {
-            throw MyException(ErrorType::InvalidArg, 5);
-        }
-        if (path.empty()) {
-            delete root_; 
-            root_ = nullptr; 
-            return;
+        std::size_t level = 0;
+        Node* n = unlink(path, level);
+        if (!n) return;
+        if (!level) {
+            release(n);
+        } else if (!background_) {
+            settleRemoved(n, level);
+            delete n;
+        } else {
+            auto counts = std::make_shared<std::promise<std::vector<std::size_t>>>();
+            pending_.push_back({level, counts->get_future()});
+            Reclaimer::instance().postUrgent([n, counts]{
+                counts->set_value(levelCounts(n));
+            });
+            release(n);
         }
+    }
 
-        Node* cur = root_;
-        for (std::size_t i = 0; i + 1 < path.size(); ++i) {
-            std::size_t idx = path[i];
-            if (!cur || idx >= max_children_) {
-                throw MyException(ErrorType::OutOfRange, 8);
-            }
-            cur = cur->children[idx];
-        }
-        std::size_t last = path.back();
-        if (!cur || last >= max_children_) {
-            throw MyException(ErrorType::OutOfRange, 8);
-        }
-        delete cur->children[last];
-        cur->children[last] = nullptr;
-        recalcHeight();
+    void clear() {
+        release(root_);
+        root_ = nullptr;
+        levels_.clear();
+        size_ = 0;
+        pending_.clear();
+    }
+
+    // Applies the counts of background erases; blocks only on a subtree
+    // the Reclaimer has not finished counting. height(), size() and
+    // memoryStats() call it, so before sharing one tree between threads
+    // call it once up front to make those accessors read-only.
+    void settle() const {
+        for (auto& p : pending_) subtract(p.level, p.counts.get());
+        pending_.clear();
     }
 
 
@@ -109,6 +370,7 @@ public:
         Node* cur = root_;
         Node* parent = nullptr;
         std::size_t idxInParent = 0;
+        std::size_t level = path.size();
 
         for (std::size_t step = 0; step < path.size(); step++) {
             std::size_t idx = path[step];
@@ -130,13 +392,14 @@ public:
             parent = cur;
             idxInParent = k;
             cur = cur->children[k];
+            ++level;
         }
 
         if (parent) parent->children[idxInParent] = nullptr;
         else root_ = nullptr;
         delete cur;
 
-        recalcHeight();
+        removed(level);
     }
     
     template<typename F>
@@ -145,15 +408,20 @@ public:
         if (!root_) {
             return r;
         }
+        settle();
         r.root_ = new Node(f(root_->value), max_children_);
-        std::function<void(Node*,Node*)> dfs = [&](Node* s, Node* d){
+        std::vector<std::pair<const Node*, Node*>> stack { {root_, r.root_} };
+        while (!stack.empty()) {
+            auto [s, d] = stack.back(); stack.pop_back();
             for (std::size_t i=0;i<max_children_;++i)
                 if (s->children[i]) {
                     d->children[i] = new Node(f(s->children[i]->value), max_children_);
-                    dfs(s->children[i], d->children[i]);
+                    stack.push_back({s->children[i], d->children[i]});
                 }
-        };
-        dfs(root_, r.root_); return r;
+        }
+        r.levels_ = levels_;
+        r.size_ = size_;
+        return r;
     }
 
     template<typename F, typename Acc>
@@ -163,51 +431,234 @@ public:
     }
 
     bool equalsSubtree(const Node* a, const Node* b) const {
-        if (!b) return true;
-        if (!a) return false;
+        std::vector<std::pair<const Node*, const Node*>> stack { {a, b} };
+        while (!stack.empty()) {
+            auto [x, y] = stack.back(); stack.pop_back();
+            if (!y) continue;
+            if (!x) return false;
 
-        if (a->value!=b->value) {
-            return false;
-        }
-        for (std::size_t i=0;i<max_children_;++i)
-            if(!equalsSubtree(a->children[i], b->children[i]) && b->children[i]) {
+            if (x->value!=y->value) {
                 return false;
             }
+            // The pattern may come from a tree of another degree.
+            for (std::size_t i=0;i<y->children.size();++i)
+                if (y->children[i]) {
+                    if (i >= x->children.size()) return false;
+                    stack.push_back({x->children[i], y->children[i]});
+                }
+        }
         return true;
     }
 
     bool containsSubtree(const Node* p) const {
-        bool ok=false;
-        preorder(root_,[&](Node* n){ if(!ok && equalsSubtree(n,p)) { ok=true; } });
-        return ok;
+        return std::any_of(begin(), end(),
+                           [&](const Visit& v){ return equalsSubtree(v.node, p); });
+    }
+
+    // Streams nodes on levels [minLevel, maxLevel] (root = 0) whose value
+    // satisfies pred to sink, in left-to-right path order, as soon as each
+    // one is reached. Stops after limit hits or when sink returns false;
+    // nothing below maxLevel is visited. Returns the number of hits.
+    template<typename Pred, typename Sink>
+    std::size_t search(Pred pred, std::size_t minLevel, std::size_t maxLevel,
+                       Sink sink, std::size_t limit = npos) const
+    {
+        std::size_t hits = 0;
+        if (minLevel > maxLevel || !limit) return 0;
+        for (PreorderIterator it(root_, maxLevel); it != end(); ++it) {
+            if (it->depth < minLevel || !pred(it->node->value)) continue;
+            ++hits;
+            if constexpr (std::is_void_v<decltype(sink(*it))>) {
+                sink(*it);
+            } else if (!sink(*it)) {
+                break;
+            }
+            if (hits == limit) break;
+        }
+        return hits;
+    }
+
+    PreorderIterator begin() const { return PreorderIterator(root_); }
+    PreorderIterator end() const { return PreorderIterator(); }
+
+    Range<PreorderIterator> preorderView() const { return {begin(), end()}; }
+    Range<PostorderIterator> postorderView() const {
+        return {PostorderIterator(root_), PostorderIterator()};
+    }
+    // Paths cost a vector copy per queued node, so level order only
+    // records them on request.
+    Range<LevelOrderIterator> levelOrderView(bool withPaths = false) const {
+        return {LevelOrderIterator(root_, withPaths), LevelOrderIterator()};
     }
 
     Node* root() const { return root_; }
     std::size_t degree() const { return max_children_; }
-    std::size_t height() const { return height_; }
+    std::size_t height() const { settle(); return levels_.size(); }
+    std::size_t size() const { settle(); return size_; }
+
+    struct MemoryStats {
+        std::size_t nodes = 0;
+        std::size_t headerBytes = 0;   // Node objects without their values
+        std::size_t childBytes = 0;    // child pointer arrays
+        std::size_t valueBytes = 0;
+        std::size_t totalBytes = 0;
+        std::size_t nullSlots = 0;
+        std::vector<double> levelFill; // nodes / child slots of the level above
+    };
+
+    // Built from counters kept up to date by every mutation, so the cost is
+    // O(height) whatever the tree size. Allocator overhead and memory owned
+    // by T itself are not included.
+    MemoryStats memoryStats() const {
+        settle();
+        MemoryStats m;
+        m.nodes = size_;
+        m.valueBytes = size_ * sizeof(T);
+        m.headerBytes = size_ * (sizeof(Node) - sizeof(T));
+        m.childBytes = size_ * max_children_ * sizeof(Node*);
+        m.totalBytes = m.headerBytes + m.childBytes + m.valueBytes;
+        m.nullSlots = size_ ? size_ * max_children_ - (size_ - 1) : 0;
+        for (std::size_t l = 0; l < levels_.size(); ++l) {
+            m.levelFill.push_back(l ? double(levels_[l]) / double(levels_[l-1] * max_children_) : 1.0);
+        }
+        return m;
+    }
 
 private:
     Node* root_ = nullptr;
     std::size_t max_children_;
-    std::size_t height_ = 0;
+    struct PendingCount {
+        std::size_t level;
+        std::future<std::vector<std::size_t>> counts;   // per level below `level`
+    };
 
-    static void preorder(Node* n, const std::function<void(Node*)>& f) {
-        if (!n) return;
-        f(n);
-        for (Node* c : n->children) {
-            preorder(c, f);
+    mutable std::vector<std::size_t> levels_;   // node count per level; size() is the height
+    mutable std::size_t size_ = 0;
+    mutable std::vector<PendingCount> pending_;
+    bool background_ = false;
+
+    void added(std::size_t level) {
+        if (levels_.size() <= level) levels_.resize(level + 1, 0);
+        ++levels_[level];
+        ++size_;
+    }
+
+    void removed(std::size_t level) {
+        if (level >= levels_.size() || !levels_[level] || !size_) {
+            throw MyException(ErrorType::Unknown, 12);
         }
+        --levels_[level];
+        --size_;
+        while (!levels_.empty() && !levels_.back()) levels_.pop_back();
     }
 
-    std::size_t depth(Node* n) const {
-        if (!n) return 0;
-        std::size_t h = 1;
-        for (Node* c : n->children)
-            h = std::max(h, 1 + depth(c));
-        return h;
+    void subtract(std::size_t level, const std::vector<std::size_t>& counts) const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            if (level + i >= levels_.size() || levels_[level + i] < counts[i]) {
+                throw MyException(ErrorType::Unknown, 12);
+            }
+            total += counts[i];
+        }
+        if (total > size_) throw MyException(ErrorType::Unknown, 12);
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            levels_[level + i] -= counts[i];
+            size_ -= counts[i];
+        }
+        while (!levels_.empty() && !levels_.back()) levels_.pop_back();
     }
 
-    void recalcHeight() {
-        height_ = depth(root_);
+    // Subtracts an unlinked subtree from the counters; if they turn out to
+    // be out of sync, the subtree is freed before the error propagates.
+    void settleRemoved(Node* n, std::size_t level) {
+        try {
+            subtract(level, levelCounts(n));
+        } catch (...) {
+            release(n);
+            throw;
+        }
+    }
+
+    // Node count per level of the subtree at n (n itself is level 0).
+    static std::vector<std::size_t> levelCounts(const Node* n) {
+        std::vector<std::size_t> counts;
+        std::vector<std::pair<const Node*, std::size_t>> stack { {n, 0} };
+        while (!stack.empty()) {
+            auto [cur, d] = stack.back(); stack.pop_back();
+            if (counts.size() <= d) counts.resize(d + 1, 0);
+            ++counts[d];
+            for (const Node* c : cur->children) {
+                if (c) stack.push_back({c, d + 1});
+            }
+        }
+        return counts;
+    }
+
+    // Unlinks the subtree at path without touching the counters, except
+    // for the root, where they are simply reset. level is path.size().
+    Node* unlink(const std::vector<std::size_t>& path, std::size_t& level) {
+        if (!root_) {
+            throw MyException(ErrorType::InvalidArg, 5);
+        }
+        level = path.size();
+        if (path.empty()) {
+            Node* n = root_;
+            root_ = nullptr;
+            levels_.clear();
+            size_ = 0;
+            pending_.clear();
+            return n;
+        }
+
+        Node* cur = root_;
+        for (std::size_t i = 0; i + 1 < path.size(); ++i) {
+            std::size_t idx = path[i];
+            if (!cur || idx >= max_children_) {
+                throw MyException(ErrorType::OutOfRange, 8);
+            }
+            cur = cur->children[idx];
+        }
+        std::size_t last = path.back();
+        if (!cur || last >= max_children_) {
+            throw MyException(ErrorType::OutOfRange, 8);
+        }
+        Node* n = cur->children[last];
+        cur->children[last] = nullptr;
+        return n;
+    }
+
+    // Nodes the Reclaimer frees per step, between which it runs urgent jobs.
+    static constexpr std::size_t kFreeChunk = 4096;
+
+    void release(Node* n) const {
+        if (!n) return;
+        if (!background_) {
+            delete n;
+            return;
+        }
+        Reclaimer::instance().postSteps([stack = std::vector<Node*>{n}]() mutable {
+            for (std::size_t i = 0; i < kFreeChunk && !stack.empty(); ++i) {
+                Node* cur = stack.back(); stack.pop_back();
+                for (Node* c : cur->children) if (c) stack.push_back(c);
+                cur->children.clear();
+                delete cur;
+            }
+            return stack.empty();
+        });
+    }
+
+    // Iterative preorder: the explicit stack keeps deep chains off the call
+    // stack, and the visitor is a template parameter so it can be inlined.
+    template<typename F>
+    static void preorder(Node* n, F&& f) {
+        if (!n) return;
+        std::vector<Node*> stack { n };
+        while (!stack.empty()) {
+            Node* cur = stack.back(); stack.pop_back();
+            f(cur);
+            for (std::size_t i = cur->children.size(); i-- > 0; ) {
+                if (cur->children[i]) stack.push_back(cur->children[i]);
+            }
+        }
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,413 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "N-aryTree.hpp"
+#include "errors.hpp"
+
+// N-ary tree that keeps dense trees in implicit (heap-indexed) form: child
+// k of slot i lives at n*i + k + 1, next to an occupancy bitset, so there
+// are no node pointers and a path lookup is plain arithmetic. Once the
+// fill ratio (nodes / slots of a complete tree of the same height) drops
+// below kToPointer it falls back to NAryTree nodes, and returns to the
+// array once it climbs back to kToImplicit. insert/find/erase/smartErase,
+// map, reduce and search behave like NAryTree's, error codes included.
+template<typename T>
+class AdaptiveNAryTree {
+public:
+    enum class Storage { Pointer, Implicit };
+
+    static constexpr double kToImplicit = 0.5;
+    static constexpr double kToPointer = 0.25;
+
+    explicit AdaptiveNAryTree(std::size_t n) : tree_(n), n_(n) {}
+
+    explicit AdaptiveNAryTree(NAryTree<T>&& t) : tree_(std::move(t)), n_(tree_.degree()) {
+        count_ = tree_.size();
+        adapt();
+    }
+
+    Storage storage() const { return implicit_ ? Storage::Implicit : Storage::Pointer; }
+    std::size_t size() const { return count_; }
+    std::size_t degree() const { return n_; }
+    std::size_t height() const { return implicit_ ? height_ : tree_.height(); }
+
+    double density() const {
+        std::size_t cap = capacity(height());
+        return cap && cap != npos ? double(count_) / double(cap) : 0.0;
+    }
+
+    void insert(const std::vector<std::size_t>& path, const T& v)
+    {
+        if (!implicit_) {
+            tree_.insert(path, v);
+            ++count_;
+            adapt();
+            return;
+        }
+        if (path.empty()) throw MyException(ErrorType::InvalidArg, 6);
+
+        std::size_t i = 0;
+        for (std::size_t s = 0; s + 1 < path.size(); ++s) {
+            if (path[s] >= n_ || !present(child(i, path[s])))
+                throw MyException(ErrorType::OutOfRange, 8);
+            i = child(i, path[s]);
+        }
+        if (path.back() >= n_) {
+            throw MyException(ErrorType::OutOfRange, 3);
+        }
+        std::size_t c = child(i, path.back());
+        if (present(c)) {
+            throw MyException(ErrorType::InvalidArg, 7);
+        }
+        if (path.size() + 1 > height_) {
+            // A new level multiplies the slot count; if that leaves the
+            // array too sparse, switch before allocating it.
+            std::size_t cap = capacity(path.size() + 1);
+            if (cap == npos || double(count_ + 1) < kToPointer * double(cap)) {
+                toPointer();
+                tree_.insert(path, v);
+                ++count_;
+                return;
+            }
+            height_ = path.size() + 1;
+            values_.resize(cap);
+            used_.resize(cap, false);
+        }
+        values_[c] = v;
+        used_[c] = true;
+        ++count_;
+    }
+
+    T* find(const std::vector<std::size_t>& path) {
+        if (!implicit_) {
+            auto* nd = tree_.find(path);
+            return nd ? &nd->value : nullptr;
+        }
+        std::size_t i = 0;
+        for (std::size_t idx : path) {
+            if (idx >= n_ || !present(child(i, idx))) return nullptr;
+            i = child(i, idx);
+        }
+        return &values_[i];
+    }
+    const T* find(const std::vector<std::size_t>& path) const {
+        return const_cast<AdaptiveNAryTree*>(this)->find(path);
+    }
+
+    void erase(const std::vector<std::size_t>& path) {
+        if (!implicit_) {
+            tree_.erase(path);
+            count_ = tree_.size();
+            adapt();
+            return;
+        }
+        if (path.empty()) {
+            reset();
+            return;
+        }
+        std::size_t i = 0;
+        for (std::size_t s = 0; s + 1 < path.size(); ++s) {
+            if (path[s] >= n_ || !present(child(i, path[s])))
+                throw MyException(ErrorType::OutOfRange, 8);
+            i = child(i, path[s]);
+        }
+        if (path.back() >= n_) {
+            throw MyException(ErrorType::OutOfRange, 8);
+        }
+        std::size_t c = child(i, path.back());
+        if (present(c)) {
+            count_ -= clearFrom(c);
+            shrink();
+            adapt();
+        }
+    }
+
+    void smartErase(const std::vector<std::size_t>& path)
+    {
+        if (!implicit_) {
+            tree_.smartErase(path);
+            --count_;
+            adapt();
+            return;
+        }
+        std::size_t i = 0;
+        bool ok = true;
+        for (std::size_t idx : path) {
+            if (!ok || idx >= n_) {
+                throw MyException(ErrorType::OutOfRange, 8);
+            }
+            i = child(i, idx);
+            ok = present(i);
+        }
+        if (!ok) {
+            throw MyException(ErrorType::InvalidArg, 5);
+        }
+        while (true) {
+            std::size_t k = firstChild(i);
+            if (k == n_) break;
+            values_[i] = values_[child(i, k)];
+            i = child(i, k);
+        }
+        used_[i] = false;
+        values_[i] = T();
+        --count_;
+        shrink();
+        adapt();
+    }
+
+    template<typename F>
+    AdaptiveNAryTree map(F f) const {
+        AdaptiveNAryTree r(n_);
+        r.count_ = count_;
+        if (!implicit_) {
+            r.tree_ = tree_.map(f);
+            return r;
+        }
+        r.implicit_ = true;
+        r.height_ = height_;
+        r.used_ = used_;
+        r.values_.resize(values_.size());
+        preorder([&](std::size_t i){ r.values_[i] = f(values_[i]); });
+        return r;
+    }
+
+    template<typename F, typename Acc>
+    Acc reduce(F f, Acc init) const {
+        if (!implicit_) return tree_.reduce(f, init);
+        preorder([&](std::size_t i){ init = f(init, values_[i]); });
+        return init;
+    }
+
+    // Same contract as NAryTree::search; the sink receives
+    // (value, level, path) and may return false to stop.
+    template<typename Pred, typename Sink>
+    std::size_t search(Pred pred, std::size_t minLevel, std::size_t maxLevel,
+                       Sink sink, std::size_t limit = npos) const
+    {
+        if (!implicit_) {
+            return tree_.search(pred, minLevel, maxLevel,
+                [&](const typename NAryTree<T>::Visit& v) {
+                    return deliver(sink, v.node->value, v.depth, v.path);
+                }, limit);
+        }
+        if (minLevel > maxLevel || !limit) return 0;
+
+        std::size_t hits = 0;
+        std::vector<std::size_t> path;
+        std::vector<std::pair<std::size_t, std::size_t>> stack { {0, 0} };
+        auto visit = [&](std::size_t i) {
+            std::size_t lvl = stack.size() - 1;
+            if (lvl < minLevel || !pred(values_[i])) return true;
+            ++hits;
+            return deliver(sink, values_[i], lvl, path) && hits != limit;
+        };
+        if (!visit(0)) return hits;
+        while (!stack.empty()) {
+            auto& [i, next] = stack.back();
+            if (stack.size() > maxLevel) next = n_;
+            while (next < n_ && !present(child(i, next))) ++next;
+            if (next < n_) {
+                std::size_t k = next++;
+                std::size_t c = child(i, k);
+                path.push_back(k);
+                stack.push_back({c, 0});
+                if (!visit(c)) return hits;
+                continue;
+            }
+            stack.pop_back();
+            if (!path.empty()) path.pop_back();
+        }
+        return hits;
+    }
+
+    // True if a tree with these numbers would be stored implicitly.
+    static bool prefersImplicit(const NAryTree<T>& t) {
+        std::size_t cap = slots(t.degree(), t.height());
+        return t.size() && cap != npos && double(t.size()) >= kToImplicit * double(cap);
+    }
+
+    // Heap bytes held by the current representation.
+    std::size_t memoryBytes() const {
+        if (!implicit_) return tree_.memoryStats().totalBytes;
+        return values_.capacity() * sizeof(T) + (used_.capacity() + 7) / 8;
+    }
+
+    // Calls f(value, hasChild) for every node in preorder, where
+    // hasChild(k) tells whether child slot k is occupied.
+    template<typename F>
+    void visitPreorder(F f) const {
+        if (!implicit_) {
+            for (const auto& v : tree_) {
+                f(v.node->value, [&](std::size_t k){ return v.node->children[k] != nullptr; });
+            }
+            return;
+        }
+        preorder([&](std::size_t i){
+            f(values_[i], [&](std::size_t k){ return present(child(i, k)); });
+        });
+    }
+
+    // Pointer-node copy, e.g. for printTree or containsSubtree.
+    NAryTree<T> toTree() const {
+        if (!implicit_) return tree_.map([](const T& v){ return v; });
+        NAryTree<T> t(n_);
+        build(t);
+        return t;
+    }
+
+private:
+    static constexpr std::size_t npos = NAryTree<T>::npos;
+
+    NAryTree<T> tree_;
+    std::size_t n_;
+    std::size_t count_ = 0;
+    bool implicit_ = false;
+    std::size_t height_ = 0;
+    std::vector<T> values_;
+    std::vector<bool> used_;
+
+    std::size_t child(std::size_t i, std::size_t k) const { return n_ * i + k + 1; }
+    bool present(std::size_t i) const { return i < used_.size() && used_[i]; }
+
+    std::size_t firstChild(std::size_t i) const {
+        for (std::size_t k = 0; k < n_; ++k) {
+            if (present(child(i, k))) return k;
+        }
+        return n_;
+    }
+
+    std::size_t capacity(std::size_t h) const { return slots(n_, h); }
+
+    // Slots in a complete tree of degree n and height h, or npos if that
+    // overflows.
+    static std::size_t slots(std::size_t n, std::size_t h) {
+        if (n == 1) return h;
+        const std::size_t lim = std::numeric_limits<std::size_t>::max() / 2;
+        std::size_t total = 0, level = 1;
+        for (std::size_t l = 0; l < h; ++l) {
+            if (total > lim - level) return npos;
+            total += level;
+            if (l + 1 < h && level > lim / n) return npos;
+            level *= n;
+        }
+        return total;
+    }
+
+    template<typename Sink>
+    static bool deliver(Sink& sink, const T& v, std::size_t lvl,
+                        const std::vector<std::size_t>& path) {
+        if constexpr (std::is_void_v<decltype(sink(v, lvl, path))>) {
+            sink(v, lvl, path);
+            return true;
+        } else {
+            return sink(v, lvl, path);
+        }
+    }
+
+    template<typename F>
+    void preorder(F&& f) const {
+        if (!implicit_) return;
+        std::vector<std::size_t> stack { 0 };
+        while (!stack.empty()) {
+            std::size_t i = stack.back(); stack.pop_back();
+            f(i);
+            for (std::size_t k = n_; k-- > 0; ) {
+                if (present(child(i, k))) stack.push_back(child(i, k));
+            }
+        }
+    }
+
+    // Descendants of slot c occupy one contiguous range per level.
+    std::size_t clearFrom(std::size_t c) {
+        std::size_t removed = 0;
+        for (std::size_t lo = c, hi = c; lo < used_.size();
+             lo = child(lo, 0), hi = child(hi, n_ - 1)) {
+            for (std::size_t j = lo; j <= hi && j < used_.size(); ++j) {
+                if (used_[j]) {
+                    used_[j] = false;
+                    values_[j] = T();
+                    ++removed;
+                }
+            }
+        }
+        return removed;
+    }
+
+    // Drops empty trailing levels.
+    void shrink() {
+        while (height_ > 0) {
+            std::size_t lo = capacity(height_ - 1), hi = capacity(height_);
+            bool any = false;
+            for (std::size_t j = lo; j < hi && !any; ++j) any = used_[j];
+            if (any) break;
+            --height_;
+            values_.resize(lo);
+            used_.resize(lo);
+        }
+    }
+
+    void reset() {
+        std::vector<T>().swap(values_);
+        std::vector<bool>().swap(used_);
+        count_ = 0;
+        height_ = 0;
+        implicit_ = false;
+    }
+
+    void adapt() {
+        if (!count_) {
+            if (implicit_) reset();
+            return;
+        }
+        std::size_t cap = capacity(height());
+        if (cap == npos) return;
+        double d = double(count_) / double(cap);
+        if (!implicit_ && d >= kToImplicit) toImplicit();
+        else if (implicit_ && d < kToPointer) toPointer();
+    }
+
+    void toImplicit() {
+        using Node = typename NAryTree<T>::Node;
+        height_ = tree_.height();
+        std::size_t cap = capacity(height_);
+        values_.assign(cap, T());
+        used_.assign(cap, false);
+        std::vector<std::pair<const Node*, std::size_t>> stack { {tree_.root(), 0} };
+        while (!stack.empty()) {
+            auto [nd, i] = stack.back(); stack.pop_back();
+            values_[i] = nd->value;
+            used_[i] = true;
+            for (std::size_t k = 0; k < n_; ++k) {
+                if (nd->children[k]) stack.push_back({nd->children[k], child(i, k)});
+            }
+        }
+        tree_.clear();
+        implicit_ = true;
+    }
+
+    void toPointer() {
+        std::size_t count = count_;
+        build(tree_);
+        reset();
+        count_ = count;
+    }
+
+    // Slots are visited in level order, so every parent exists before
+    // its children are linked to it.
+    void build(NAryTree<T>& t) const {
+        using Node = typename NAryTree<T>::Node;
+        std::vector<Node*> nodes(values_.size(), nullptr);
+        t.insert({}, values_[0]);
+        nodes[0] = t.root();
+        std::size_t lvl = 0, nextLevel = capacity(1);
+        for (std::size_t i = 1; i < values_.size(); ++i) {
+            while (i >= nextLevel) nextLevel = capacity(++lvl + 1);
+            if (!used_[i]) continue;
+            std::size_t p = (i - 1) / n_;
+            nodes[i] = t.insertChild(nodes[p], lvl - 1, (i - 1) % n_, values_[i]);
+        }
+    }
+};
@@ -37,7 +37,10 @@ inline std::vector<ErrorInfo> g_ErrorTable = {
     {7,  "Node already exists"},
     {8,  "Invalid path"},
     {9,  "Tree id out of range"},
-    {10, "No trees were created yet"}
+    {10, "No trees were created yet"},
+    {11, "Tree store file I/O failed"},
+    {12, "Tree counters out of sync (nodes linked outside NAryTree)"},
+    {13, "No pattern tree ids given"}
 };
 
 inline std::string getErrorMessage(int code)
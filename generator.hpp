@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "N-aryTree.hpp"
+#include "parallel.hpp"
+
+// Counter-based generator: each draw is a pure function of
+// (seed, stream, counter), so it does not matter which thread asks.
+class CounterRng {
+public:
+    explicit CounterRng(std::uint64_t seed) : seed_(seed) {}
+
+    std::uint64_t at(std::uint64_t stream, std::uint64_t counter) const {
+        return mix(seed_ ^ mix(stream * 0x9E3779B97F4A7C15ull + mix(counter)));
+    }
+
+    // Uniform in [lo, hi] without modulo bias: draws past the last whole
+    // multiple of the span are rejected and rehashed.
+    long long range(std::uint64_t stream, std::uint64_t counter,
+                    long long lo, long long hi) const {
+        std::uint64_t span = static_cast<std::uint64_t>(hi) - static_cast<std::uint64_t>(lo) + 1;
+        std::uint64_t x = at(stream, counter);
+        if (!span) return static_cast<long long>(x);
+        std::uint64_t limit = ~std::uint64_t(0) - (~std::uint64_t(0) % span + 1) % span;
+        while (x > limit) x = mix(x);
+        return static_cast<long long>(static_cast<std::uint64_t>(lo) + x % span);
+    }
+
+private:
+    std::uint64_t seed_;
+
+    static std::uint64_t mix(std::uint64_t z) {
+        z += 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+struct RandomTreeSpec {
+    std::size_t height;
+    unsigned fillPercent;
+    int lo, hi;
+    std::uint64_t seed;
+};
+
+// Grows an empty tree level by level. On each level, round(slots * fill%)
+// of the free child slots are picked uniformly and filled with values from
+// [lo, hi]. Slot keys and values depend only on (seed, level, slot), so
+// the same seed yields the same tree for any thread count; key and value
+// generation is split across `threads` workers (0 = hardware concurrency).
+template<typename T>
+void fillRandomTree(NAryTree<T>& tree, const RandomTreeSpec& spec, unsigned threads = 0)
+{
+    using Node = typename NAryTree<T>::Node;
+    const std::size_t grain = 1 << 14;
+    CounterRng rng(spec.seed);
+    const std::size_t n = tree.degree();
+
+    tree.insert({}, static_cast<T>(rng.range(1, 0, spec.lo, spec.hi)));
+    std::vector<Node*> parents { tree.root() };
+
+    for (std::size_t lvl = 1; lvl < spec.height && !parents.empty(); ++lvl) {
+        const std::size_t slots = parents.size() * n;
+        const std::size_t need = std::min(slots, (slots * spec.fillPercent + 50) / 100);
+        if (!need) break;
+
+        std::vector<std::pair<std::uint64_t, std::size_t>> keys(slots);
+        parallelFor(slots, grain, threads, [&](std::size_t a, std::size_t b) {
+            for (std::size_t i = a; i < b; ++i) keys[i] = {rng.at(2 * lvl, i), i};
+        });
+        // The need smallest (key, slot) pairs win; keys are unique since
+        // they carry the slot, so the choice is the same on every run.
+        if (need < slots)
+            std::nth_element(keys.begin(), keys.begin() + (need - 1), keys.end());
+        std::vector<std::size_t> chosen(need);
+        for (std::size_t j = 0; j < need; ++j) chosen[j] = keys[j].second;
+        std::vector<std::pair<std::uint64_t, std::size_t>>().swap(keys);
+        std::sort(chosen.begin(), chosen.end());
+
+        std::vector<T> values(chosen.size());
+        parallelFor(chosen.size(), grain, threads, [&](std::size_t a, std::size_t b) {
+            for (std::size_t j = a; j < b; ++j)
+                values[j] = static_cast<T>(rng.range(2 * lvl + 1, chosen[j], spec.lo, spec.hi));
+        });
+
+        std::vector<Node*> next;
+        next.reserve(chosen.size());
+        for (std::size_t j = 0; j < chosen.size(); ++j) {
+            std::size_t s = chosen[j];
+            next.push_back(tree.insertChild(parents[s / n], lvl - 1, s % n, values[j]));
+        }
+        parents.swap(next);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs f(lo, hi) over [0, n) in blocks of `grain` indices, handed out to
+// `threads` workers (0 = hardware concurrency) as they become free.
+// The calling thread works too; f must not throw.
+template<typename F>
+void parallelFor(std::size_t n, std::size_t grain, unsigned threads, F f)
+{
+    if (!n) return;
+    if (!grain) grain = 1;
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t blocks = (n + grain - 1) / grain;
+    if (threads > blocks) threads = static_cast<unsigned>(blocks);
+    if (threads <= 1) {
+        f(std::size_t(0), n);
+        return;
+    }
+
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        while (true) {
+            std::size_t lo = next.fetch_add(grain);
+            if (lo >= n) break;
+            f(lo, std::min(n, lo + grain));
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "N-aryTree.hpp"
+#include "parallel.hpp"
+
+struct PatternMatch {
+    std::size_t pattern;
+    std::size_t tree;
+    std::vector<std::size_t> path;
+};
+
+// Finds every occurrence of every pattern in every tree, with the same
+// matching rule as NAryTree::containsSubtree. Patterns are indexed once by
+// root value and a shape signature (height and occupied root slots), so
+// each tree is walked a single time no matter how many patterns there are.
+// Trees are spread over `threads` workers (0 = hardware concurrency).
+// Results are ordered by tree, then preorder position, then pattern.
+// Empty patterns and null entries are skipped.
+template<typename T>
+std::vector<PatternMatch> matchPatterns(const std::vector<const NAryTree<T>*>& patterns,
+                                        const std::vector<const NAryTree<T>*>& trees,
+                                        unsigned threads = 0)
+{
+    struct Entry {
+        std::size_t id;
+        std::size_t height;
+        std::uint64_t mask;
+    };
+    // Slots past 63 share the top bit, so the mask test stays conservative.
+    auto slotMask = [](const typename NAryTree<T>::Node* n) {
+        std::uint64_t m = 0;
+        for (std::size_t i = 0; i < n->children.size(); ++i)
+            if (n->children[i]) m |= std::uint64_t(1) << std::min<std::size_t>(i, 63);
+        return m;
+    };
+
+    // Fold in pending background erases and read the heights here, so the
+    // workers never call settle(), even if a tree is listed twice.
+    for (const auto* t : patterns) if (t) t->settle();
+    std::vector<std::size_t> heights(trees.size(), 0);
+    for (std::size_t t = 0; t < trees.size(); ++t)
+        if (trees[t]) heights[t] = trees[t]->height();
+
+    std::unordered_map<T, std::vector<Entry>> index;
+    for (std::size_t p = 0; p < patterns.size(); ++p) {
+        if (!patterns[p] || !patterns[p]->root()) continue;
+        const auto* r = patterns[p]->root();
+        index[r->value].push_back({p, patterns[p]->height(), slotMask(r)});
+    }
+
+    std::vector<std::vector<PatternMatch>> perTree(trees.size());
+    if (!index.empty()) {
+        parallelFor(trees.size(), 1, threads, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t t = lo; t < hi; ++t) {
+                const NAryTree<T>* tree = trees[t];
+                if (!tree) continue;
+                const std::size_t height = heights[t];
+                for (const auto& v : *tree) {
+                    auto it = index.find(v.node->value);
+                    if (it == index.end()) continue;
+                    std::uint64_t have = slotMask(v.node);
+                    for (const Entry& e : it->second) {
+                        if (v.depth + e.height > height) continue;
+                        if (e.mask & ~have) continue;
+                        if (tree->equalsSubtree(v.node, patterns[e.id]->root()))
+                            perTree[t].push_back({e.id, t, v.path});
+                    }
+                }
+            }
+        });
+    }
+
+    std::vector<PatternMatch> out;
+    for (auto& r : perTree) {
+        out.insert(out.end(), std::make_move_iterator(r.begin()),
+                   std::make_move_iterator(r.end()));
+    }
+    return out;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Frees detached subtrees on a background thread, so dropping a huge tree
+// costs the caller one queue push instead of one delete per node.
+//
+// Work comes in two queues. Frees run in FIFO order and may be split into
+// steps; urgent jobs (the per-level counts a tree waits for in settle())
+// run before any queued free and between the steps of the current one,
+// so a small erase never waits for an unrelated big free to finish.
+class Reclaimer {
+public:
+    static Reclaimer& instance() {
+        static Reclaimer r;
+        return r;
+    }
+
+    template<typename P>
+    void retire(P* p) {
+        if (p) post([p]{ delete p; });
+    }
+
+    // Runs job on the worker thread, after every free posted before it.
+    void post(std::function<void()> job) {
+        postSteps([job = std::move(job)]{ job(); return true; });
+    }
+
+    // A free done in steps: step() is called until it returns true, and
+    // urgent jobs posted meanwhile run between two calls.
+    void postSteps(std::function<bool()> step) {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            frees_.push_back(std::move(step));
+        }
+        cv_.notify_one();
+    }
+
+    // Runs job on the worker thread ahead of all queued frees.
+    void postUrgent(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            urgent_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    // Test hooks: while paused the worker starts no new job or step; work
+    // keeps queueing until resume().
+    void pause() {
+        std::lock_guard<std::mutex> lk(m_);
+        paused_ = true;
+    }
+    void resume() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            paused_ = false;
+        }
+        cv_.notify_one();
+    }
+
+    // Blocks until everything retired so far has been freed.
+    void drain() {
+        std::unique_lock<std::mutex> lk(m_);
+        idle_.wait(lk, [&]{ return idle(); });
+    }
+
+    std::size_t pending() {
+        std::lock_guard<std::mutex> lk(m_);
+        return urgent_.size() + frees_.size() + (busy_ ? 1 : 0);
+    }
+
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    ~Reclaimer() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        worker_.join();
+    }
+
+private:
+    std::mutex m_;
+    std::condition_variable cv_, idle_;
+    std::deque<std::function<void()>> urgent_;
+    std::deque<std::function<bool()>> frees_;
+    bool busy_ = false;
+    bool paused_ = false;
+    bool stop_ = false;
+    std::thread worker_;
+
+    Reclaimer() : worker_([this]{ run(); }) {}
+
+    bool idle() const { return urgent_.empty() && frees_.empty() && !busy_; }
+
+    // Takes one urgent job or one step of the oldest free per iteration;
+    // an unfinished free stays at the front of its queue.
+    void run() {
+        std::unique_lock<std::mutex> lk(m_);
+        while (true) {
+            cv_.wait(lk, [&]{
+                return stop_ || (!paused_ && (!urgent_.empty() || !frees_.empty()));
+            });
+            if (urgent_.empty() && frees_.empty()) break;
+            busy_ = true;
+            if (!urgent_.empty()) {
+                auto job = std::move(urgent_.front());
+                urgent_.pop_front();
+                lk.unlock();
+                job();
+                lk.lock();
+            } else {
+                auto step = std::move(frees_.front());
+                frees_.pop_front();
+                lk.unlock();
+                bool done = step();
+                lk.lock();
+                if (!done) frees_.push_front(std::move(step));
+            }
+            busy_ = false;
+            if (idle()) idle_.notify_all();
+        }
+    }
+};
@@ -1,8 +1,13 @@
 #include "N-aryTree.hpp"
 #include "ui.h"
 #include "errors.hpp"
+#include "adaptivetree.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <filesystem>
+#include <memory>
+#include <numeric>
 #include <vector>
 #include <string>
 
@@ -20,6 +25,14 @@ void assertThrows(F fn, ErrorType type, uint8_t code)
     assert(caught && "exception not thrown");
 }
 
+// пары (путь, значение) в прямом порядке обхода — для сравнения деревьев
+std::vector<std::pair<std::vector<std::size_t>, int>> dump(const NAryTree<int>& t)
+{
+    std::vector<std::pair<std::vector<std::size_t>, int>> out;
+    for (const auto& v : t) out.push_back({v.path, v.node->value});
+    return out;
+}
+
 // 1. конструктор
 void testNegativeDegree()
 {
@@ -176,6 +189,472 @@ void testManyInsertErase()
     assert(t.reduce([](int a,int b){return a+b;},0)==0);
 }
 
+// 14. очень глубокая цепочка (без рекурсии)
+void testVeryDeepChain()
+{
+    using N = NAryTree<int>::Node;
+    const int DEPTH = 300000;
+    NAryTree<int> t(1);
+    t.insert({}, 0);
+    t.insert({0}, 1);
+    N* cur = t.find({0});
+    for (int i = 2; i < DEPTH; ++i) {
+        cur = t.insertChild(cur, i - 1, 0, i);
+    }
+    assert(t.height() == std::size_t(DEPTH));
+    assert(t.reduce([](int a,int){ return a+1; }, 0) == DEPTH);
+
+    auto copy = t.map([](int x){ return x; });
+    assert(copy.reduce([](int a,int){ return a+1; }, 0) == DEPTH);
+    assert(t.containsSubtree(copy.find({0})));
+
+    t.erase({0,0});
+    assert(t.height() == 2);
+}
+
+// 15. итераторы обхода
+void testTraversalIterators()
+{
+    using V = NAryTree<int>::Visit;
+    using Path = std::vector<std::size_t>;
+    NAryTree<int> t(3);
+    t.insert({},    1);
+    t.insert({0},   2);
+    t.insert({2},   3);
+    t.insert({0,1}, 4);
+    t.insert({2,0}, 5);
+
+    std::vector<int> pre, post, lvl;
+    for (const V& v : t.preorderView())  pre.push_back(v.node->value);
+    for (const V& v : t.postorderView()) post.push_back(v.node->value);
+    for (const V& v : t.levelOrderView()) lvl.push_back(v.node->value);
+    assert((pre  == std::vector<int>{1,2,4,3,5}));
+    assert((post == std::vector<int>{4,2,5,3,1}));
+    assert((lvl  == std::vector<int>{1,2,3,4,5}));
+
+    auto it = std::find_if(t.begin(), t.end(),
+                           [](const V& v){ return v.node->value == 5; });
+    assert(it != t.end());
+    assert(it->depth == 2);
+    assert((it->path == Path{2,0}));
+
+    auto post4 = t.postorderView().begin();
+    assert(post4->depth == 2 && (post4->path == Path{0,1}));
+
+    auto lv = t.levelOrderView(true);
+    auto l5 = std::find_if(lv.begin(), lv.end(),
+                           [](const V& v){ return v.node->value == 4; });
+    assert((l5->path == Path{0,1}));
+
+    int sum = std::transform_reduce(t.begin(), t.end(), 0, std::plus<>(),
+                                    [](const V& v){ return v.node->value; });
+    assert(sum == 15);
+
+    NAryTree<int> empty(2);
+    assert(empty.begin() == empty.end());
+    assert(empty.postorderView().begin() == empty.postorderView().end());
+}
+
+// 16. ленивый поиск по уровням
+void testLazySearch()
+{
+    using V = NAryTree<int>::Visit;
+    using Path = std::vector<std::size_t>;
+    NAryTree<int> t(2);
+    t.insert({},    7);
+    t.insert({0},   7);
+    t.insert({1},   3);
+    t.insert({0,0}, 7);
+    t.insert({1,1}, 8);
+
+    auto is7 = [](int v){ return v == 7; };
+    std::vector<Path> got;
+    auto collect = [&](const V& v){ got.push_back(v.path); };
+
+    assert(t.search(is7, 1, 1, collect) == 1);
+    assert((got == std::vector<Path>{{0}}));
+
+    got.clear();
+    assert(t.search(is7, 0, 2, collect) == 3);
+    assert((got == std::vector<Path>{{}, {0}, {0,0}}));
+
+    got.clear();
+    assert(t.search(is7, 0, 2, collect, 2) == 2);
+    assert(got.size() == 2);
+
+    std::size_t seen = 0;
+    assert(t.search([](int v){ return v > 5; }, 0, 5,
+                    [&](const V&){ return ++seen < 1; }) == 1);
+
+    assert(t.search(is7, 2, 1, collect) == 0);
+    assert(t.search([](int v){ return v == 8; }, 0, 1, collect) == 0);
+}
+
+// 17. фоновое освобождение и clear
+void testBackgroundReclaim()
+{
+    NAryTree<int> t(2);
+    t.setBackgroundReclaim(true);
+    t.insert({},    0);
+    t.insert({0},   1);
+    t.insert({0,1}, 2);
+    t.insert({1},   3);
+
+    t.erase({0});
+    assert(t.find({0}) == nullptr);
+    assert(t.height() == 2);
+    assert(t.reduce([](int a,int b){ return a+b; }, 0) == 3);
+
+    NAryTree<int>::Node* n = t.detach({1});
+    assert(n->value == 3 && t.height() == 1);
+    delete n;
+
+    t.clear();
+    assert(t.root() == nullptr && t.height() == 0);
+    t.insert({}, 5);
+
+    Reclaimer::instance().drain();
+    assert(Reclaimer::instance().pending() == 0);
+
+    // erase не обходит поддерево: пока Reclaimer стоит, работа лежит в очереди
+    NAryTree<int> big(2);
+    big.setBackgroundReclaim(true);
+    fillRandomTree(big, {18, 100, 0, 9, 1});
+    assert(big.size() == (std::size_t(1) << 18) - 1);
+    Reclaimer::instance().pause();
+    big.erase({0});
+    assert(Reclaimer::instance().pending() == 2);   // подсчёт + освобождение
+    assert(big.find({0}) == nullptr && big.find({1}) != nullptr);
+    Reclaimer::instance().resume();
+    assert(big.size() == (std::size_t(1) << 17));
+    assert(big.height() == 18);
+    assert(big.memoryStats().levelFill[1] == 0.5);
+
+    // подсчёт для мелкого erase не ждёт освобождения чужого большого дерева
+    NAryTree<int> huge(2), small(2);
+    huge.setBackgroundReclaim(true);
+    small.setBackgroundReclaim(true);
+    fillRandomTree(huge, {20, 100, 0, 9, 2});
+    small.insert({},    0);
+    small.insert({0},   1);
+    small.insert({0,0}, 2);
+    small.insert({0,1}, 3);
+    Reclaimer::instance().drain();
+    Reclaimer::instance().pause();
+    huge.clear();
+    small.erase({0});
+    Reclaimer::instance().resume();
+    assert(small.height() == 1 && small.size() == 1);
+    assert(Reclaimer::instance().pending() > 0);    // huge ещё освобождается
+    Reclaimer::instance().drain();
+}
+
+// 18. пакетный поиск шаблонов
+void testBatchPatterns()
+{
+    using Path = std::vector<std::size_t>;
+    NAryTree<int> a(2), b(3), p1(2), p2(2), p3(1), empty(2);
+    a.insert({},    1);
+    a.insert({0},   2);
+    a.insert({1},   2);
+    a.insert({1,0}, 3);
+    b.insert({},    2);
+    b.insert({0},   3);
+
+    p1.insert({},  2);
+    p1.insert({0}, 3);
+    p2.insert({},  2);
+    p3.insert({},  9);
+
+    std::vector<const NAryTree<int>*> pats { &p1, &p2, &p3, &empty };
+    std::vector<const NAryTree<int>*> trees { &a, &b };
+    auto res = matchPatterns(pats, trees, 2);
+
+    assert(res.size() == 5);
+    assert(res[0].pattern == 1 && res[0].tree == 0 && (res[0].path == Path{0}));
+    assert(res[1].pattern == 0 && res[1].tree == 0 && (res[1].path == Path{1}));
+    assert(res[2].pattern == 1 && res[2].tree == 0 && (res[2].path == Path{1}));
+    assert(res[3].pattern == 0 && res[3].tree == 1 && res[3].path.empty());
+    assert(res[4].pattern == 1 && res[4].tree == 1 && res[4].path.empty());
+
+    for (std::size_t t = 0; t < trees.size(); ++t)
+        for (std::size_t p = 0; p < 3; ++p) {
+            bool any = std::any_of(res.begin(), res.end(), [&](const PatternMatch& m){
+                return m.pattern == p && m.tree == t; });
+            assert(any == trees[t]->containsSubtree(pats[p]->root()));
+        }
+
+    // одно дерево дважды, с незавершённым фоновым удалением
+    a.setBackgroundReclaim(true);
+    a.insert({0,0}, 7);
+    a.erase({0,0});
+    std::vector<const NAryTree<int>*> twice { &a, &a };
+    auto res2 = matchPatterns(pats, twice, 2);
+    assert(res2.size() == 6);
+    assert(res2[3].tree == 1 && res2[3].path == res2[0].path);
+}
+
+// 19. воспроизводимая генерация случайного дерева
+void testSeededRandomTree()
+{
+    using V = NAryTree<int>::Visit;
+    RandomTreeSpec spec{6, 60, -5, 5, 12345};
+    NAryTree<int> a(3), b(3), c(3);
+    fillRandomTree(a, spec, 1);
+    fillRandomTree(b, spec, 4);
+    spec.seed = 54321;
+    fillRandomTree(c, spec, 2);
+
+    assert(dump(a) == dump(b));
+    assert(dump(a) != dump(c));
+    assert(a.height() == 6);
+
+    std::vector<std::size_t> perLevel(6, 0);
+    for (const V& v : a) {
+        ++perLevel[v.depth];
+        assert(v.node->value >= -5 && v.node->value <= 5);
+    }
+    assert(perLevel[0] == 1);
+    for (std::size_t l = 1; l < 6; ++l) {
+        assert(perLevel[l] == (perLevel[l-1] * 3 * 60 + 50) / 100);
+    }
+
+    NAryTree<int> full(2);
+    fillRandomTree(full, {4, 100, 7, 7, 1});
+    assert(full.reduce([](int acc,int v){ return acc + v; }, 0) == 15 * 7);
+
+    CounterRng rng(42);
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        long long x = rng.range(0, i, 0, 2);
+        assert(x >= 0 && x <= 2);
+    }
+}
+
+// 20. неявное (массивное) хранение против указательного
+void testAdaptiveStorage()
+{
+    using Path = std::vector<std::size_t>;
+    using Ad = AdaptiveNAryTree<int>;
+
+    Ad d(2);
+    assert(d.storage() == Ad::Storage::Pointer);
+    d.insert({}, 1);
+    assert(d.storage() == Ad::Storage::Implicit);
+    d.insert({0}, 2);
+    d.insert({1}, 3);
+    d.insert({0,0}, 4);
+    assert(d.storage() == Ad::Storage::Implicit);
+    assert(*d.find({0,0}) == 4 && d.find({1,1}) == nullptr);
+    assertThrows([&]{ d.insert({}, 9); },    ErrorType::InvalidArg, 6);
+    assertThrows([&]{ d.insert({1,1,0}, 9); }, ErrorType::OutOfRange, 8);
+    assertThrows([&]{ d.insert({2}, 9); },   ErrorType::OutOfRange, 3);
+    assertThrows([&]{ d.insert({0}, 9); },   ErrorType::InvalidArg, 7);
+
+    d.insert({0,0,0}, 5);
+    d.insert({0,0,0,0}, 6);
+    assert(d.storage() == Ad::Storage::Pointer);
+    d.erase({0,0,0});
+    assert(d.storage() == Ad::Storage::Implicit && d.height() == 3);
+
+    // случайные операции: результат должен совпадать с NAryTree
+    CounterRng rng(7);
+    for (std::size_t deg = 1; deg <= 3; ++deg) {
+        NAryTree<int> ref(deg);
+        Ad ad(deg);
+        std::vector<Path> known { {} };
+        ref.insert({}, 0);
+        ad.insert({}, 0);
+        std::size_t switches = 0;
+        auto prev = ad.storage();
+        for (std::uint64_t step = 0; step < 3000; ++step) {
+            std::uint64_t r = rng.at(deg, step);
+            Path p = known[r % known.size()];
+            int op = static_cast<int>((r >> 32) % 10);
+            if (op < 7) {
+                p.push_back((r >> 40) % (deg + 1));
+                bool refOk = true, adOk = true;
+                try { ref.insert(p, int(step)); } catch (const MyException&) { refOk = false; }
+                try { ad.insert(p, int(step)); }  catch (const MyException&) { adOk = false; }
+                assert(refOk == adOk);
+                if (refOk) known.push_back(p);
+            } else if (op < 9 && !p.empty()) {
+                ref.erase(p);
+                ad.erase(p);
+            } else if (ref.find(p)) {
+                ref.smartErase(p);
+                ad.smartErase(p);
+            }
+            known.erase(std::remove_if(known.begin(), known.end(),
+                        [&](const Path& q){ return !ref.find(q); }), known.end());
+            if (known.empty()) {
+                ref.insert({}, 0);
+                ad.insert({}, 0);
+                known.push_back({});
+            }
+            if (ad.storage() != prev) { ++switches; prev = ad.storage(); }
+
+            assert(ad.height() == ref.height());
+            assert(ad.reduce([](unsigned long a,int v){ return a * 31 + unsigned(v); }, 0UL)
+                   == ref.reduce([](unsigned long a,int v){ return a * 31 + unsigned(v); }, 0UL));
+        }
+        assert(deg == 1 ? ad.storage() == Ad::Storage::Implicit : switches > 0);
+
+        std::vector<Path> a, b;
+        ref.search([](int v){ return v % 2 == 0; }, 1, 4,
+                   [&](const NAryTree<int>::Visit& v){ a.push_back(v.path); });
+        ad.search([](int v){ return v % 2 == 0; }, 1, 4,
+                  [&](int, std::size_t, const Path& q){ b.push_back(q); });
+        assert(a == b);
+
+        auto m = ad.map([](int v){ return v + 1; });
+        assert(m.reduce([](long acc,int v){ return acc + v; }, 0L)
+               == ref.reduce([](long acc,int v){ return acc + v + 1; }, 0L));
+        NAryTree<int> back = ad.toTree();
+        assert(back.containsSubtree(ref.root()) && ref.containsSubtree(back.root()));
+    }
+}
+
+// 21. учёт памяти
+void testMemoryStats()
+{
+    using N = NAryTree<int>::Node;
+    NAryTree<int> t(3);
+    auto m = t.memoryStats();
+    assert(m.nodes == 0 && m.totalBytes == 0 && m.levelFill.empty());
+
+    t.insert({},    1);
+    t.insert({0},   2);
+    t.insert({2},   3);
+    t.insert({2,1}, 4);
+    m = t.memoryStats();
+    assert(t.size() == 4 && m.nodes == 4);
+    assert(m.nullSlots == 4 * 3 - 3);
+    assert(m.childBytes == 4 * 3 * sizeof(N*));
+    assert(m.valueBytes == 4 * sizeof(int));
+    assert(m.totalBytes == 4 * sizeof(N) + m.childBytes);
+    assert((m.levelFill == std::vector<double>{1.0, 2.0 / 3, 1.0 / 6}));
+
+    t.smartErase({2});
+    assert(t.size() == 3 && t.height() == 2);
+    t.insert({2,0}, 5);
+    t.erase({2});
+    assert(t.size() == 2 && t.height() == 2);
+    assert(t.memoryStats().nullSlots == 2 * 3 - 1);
+
+    auto c = t.map([](int x){ return x; });
+    assert(c.size() == 2 && c.height() == 2);
+    NAryTree<int> moved(std::move(c));
+    assert(moved.size() == 2 && c.size() == 0 && c.height() == 0);
+
+    t.clear();
+    assert(t.size() == 0 && t.height() == 0);
+
+    // узлы, привязанные в обход дерева, ловятся при удалении
+    using NI = NAryTree<int>;
+    NI h(1);
+    h.insert({}, 0);
+    h.insert({0}, 1);
+    h.find({0})->children[0] = new NI::Node(2, 1);
+    h.find({0, 0})->children[0] = new NI::Node(3, 1);
+    assertThrows([&]{ h.erase({0}); }, ErrorType::Unknown, 12);
+    assertThrows([&]{ h.insertChild(h.root(), 5, 0, 9); }, ErrorType::OutOfRange, 8);
+}
+
+// 22. хранилище деревьев с вытеснением на диск
+void testTreeStore()
+{
+    const std::string dir = "tree_spill_test";
+    {
+        TreeStore<int> store(0, dir);
+        auto a = std::make_unique<NAryTree<int>>(11);
+        fillRandomTree(*a, {4, 40, -100, 100, 3});
+        auto b = std::make_unique<NAryTree<int>>(2);
+        b->insert({}, 1);
+        const auto dumpA = dump(*a);
+        const std::size_t sizeA = a->size();
+
+        assert(store.add(std::move(a)) == 0);
+        assert(store.add(std::move(b)) == 1);
+        assert(store.add(std::make_unique<NAryTree<int>>(3)) == 2);
+
+        store.trim();
+        assert(!store.resident(0) && !store.resident(1) && store.resident(2));
+        assert(std::filesystem::exists(dir));
+
+        NAryTree<int>& back = store.get(0);
+        assert(back.size() == sizeA && back.height() == 4);
+        assert(dump(back) == dumpA);
+
+        store.remove(1);
+        assert(store.size() == 2);
+        store.trim();
+        assert(store.resident(0) && !store.resident(1));
+        assert(store.get(1).size() == 0 && store.get(1).degree() == 3);
+
+        store.setBudget(std::size_t(1) << 30);
+        store.trim();
+        assert(store.resident(0) && store.resident(1));
+        assertThrows([&]{ store.get(2); }, ErrorType::OutOfRange, 9);
+    }
+    {
+        // плотное дерево сначала упаковывается в неявную форму
+        TreeStore<int> store(64 * 1024, dir);
+        auto dense = std::make_unique<NAryTree<int>>(2);
+        fillRandomTree(*dense, {12, 100, 0, 1000, 9});
+        const auto dumpDense = dump(*dense);
+        store.add(std::move(dense));
+        store.add(std::make_unique<NAryTree<int>>(2));
+
+        store.trim();
+        assert(store.resident(0) && store.compacted(0));
+        assert(store.residentBytes() <= store.budget());
+        assert(!std::filesystem::exists(dir));
+        assert(dump(store.get(0)) == dumpDense);
+        assert(!store.compacted(0));
+
+        store.get(1);
+        store.setBudget(0);
+        store.trim();
+        assert(!store.resident(0));
+        assert(dump(store.get(0)) == dumpDense);
+    }
+    {
+        // пакетный обход всех деревьев не выходит за бюджет
+        TreeStore<int> store(std::size_t(1) << 30, dir);
+        for (std::uint64_t seed = 1; seed <= 6; ++seed) {
+            auto t = std::make_unique<NAryTree<int>>(3);
+            fillRandomTree(*t, {7, 30, 0, 9, seed});
+            store.add(std::move(t));
+        }
+        auto pattern = std::make_unique<NAryTree<int>>(3);
+        pattern->insert({}, 1);
+        store.add(std::move(pattern));
+
+        const std::size_t one = store.residentBytes() / 6;
+        store.setBudget(3 * one);
+        store.trim();
+        assert(store.residentBytes() <= store.budget());
+
+        const NAryTree<int>* pat = &store.get(6);
+        store.pin(6);
+        std::vector<std::size_t> seen;
+        std::size_t batches = 0;
+        store.forEachBatch([&](const std::vector<std::size_t>& ids,
+                               const std::vector<NAryTree<int>*>& trees) {
+            ++batches;
+            assert(ids.size() == trees.size());
+            assert(store.residentBytes() <= store.budget());
+            assert(store.resident(6) && &store.get(6) == pat);
+            seen.insert(seen.end(), ids.begin(), ids.end());
+        });
+        store.unpin(6);
+        assert((seen == std::vector<std::size_t>{0, 1, 2, 3, 4, 5, 6}));
+        assert(batches > 1);
+        assert(store.residentBytes() <= store.budget());
+    }
+    assert(!std::filesystem::exists(dir));
+}
+
 int main()
 {
     testNegativeDegree();
@@ -192,6 +671,15 @@ int main()
     testParsePath();
     testEraseBranch();
     testManyInsertErase();
+    testVeryDeepChain();
+    testTraversalIterators();
+    testLazySearch();
+    testBackgroundReclaim();
+    testBatchPatterns();
+    testSeededRandomTree();
+    testAdaptiveStorage();
+    testMemoryStats();
+    testTreeStore();
 
     std::cout << "[OK] all tests passed\n";
     return 0;
@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "N-aryTree.hpp"
+#include "adaptivetree.hpp"
+#include "errors.hpp"
+
+// Owns the session's trees and keeps the resident ones within a memory
+// budget (NAryTree::memoryStats plus estimated allocator overhead).
+// trim() first packs cold dense trees into AdaptiveNAryTree's
+// pointer-free implicit form, then
+// spills the least recently used trees to files in `dir`; get() turns
+// either back into an NAryTree. Ids are positions, as in the old vector:
+// remove() shifts later ones.
+//
+// File format: "NAT1", degree and node count as uint64, then one record
+// per node in preorder: the raw value followed by a bitmask of occupied
+// child slots. Reading rebuilds the tree with an explicit stack, so
+// neither direction holds more than one record plus O(height) in memory.
+template<typename T>
+class TreeStore {
+    static_assert(std::is_trivially_copyable_v<T>, "TreeStore spills raw values");
+
+public:
+    explicit TreeStore(std::size_t budgetBytes, std::string dir = "tree_spill")
+        : budget_(budgetBytes), dir_(std::move(dir))
+    {
+        std::stringstream ss;
+        ss << std::hex << std::random_device{}();
+        tag_ = ss.str();
+    }
+
+    ~TreeStore() {
+        for (auto& e : entries_) {
+            dropFile(e);
+        }
+        std::error_code ec;
+        std::filesystem::remove(dir_, ec);   // only succeeds if empty
+    }
+
+    TreeStore(const TreeStore&) = delete;
+    TreeStore& operator=(const TreeStore&) = delete;
+
+    std::size_t add(std::unique_ptr<NAryTree<T>> t) {
+        Entry e;
+        e.degree = t->degree();
+        e.background = t->backgroundReclaim();
+        e.tree = std::move(t);
+        e.lastUse = ++clock_;
+        entries_.push_back(std::move(e));
+        return entries_.size() - 1;
+    }
+
+    NAryTree<T>& get(std::size_t id) {
+        Entry& e = at(id);
+        if (e.compact) {
+            e.tree = std::make_unique<NAryTree<T>>(e.compact->toTree());
+            e.tree->setBackgroundReclaim(e.background);
+            e.compact.reset();
+        } else if (!e.tree) {
+            load(e);
+        }
+        e.lastUse = ++clock_;
+        return *e.tree;
+    }
+
+    void remove(std::size_t id) {
+        dropFile(at(id));
+        entries_.erase(entries_.begin() + id);
+    }
+
+    std::size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    bool resident(std::size_t id) const { return at(id).tree || at(id).compact; }
+    bool compacted(std::size_t id) const { return static_cast<bool>(at(id).compact); }
+
+    std::size_t budget() const { return budget_; }
+    void setBudget(std::size_t bytes) { budget_ = bytes; }
+
+    std::size_t residentBytes() const {
+        std::size_t total = 0;
+        for (const auto& e : entries_) total += bytesOf(e);
+        return total;
+    }
+
+    // How much residentBytes() would grow if get(id) were called now.
+    std::size_t loadCost(std::size_t id) const {
+        const Entry& e = at(id);
+        if (e.tree) return 0;
+        std::size_t nodes = e.compact ? e.compact->size() : e.nodes;
+        std::size_t full = nodeBytes(nodes, e.degree), now = bytesOf(e);
+        return full > now ? full - now : 0;
+    }
+
+    // Pinned trees are never packed or spilled by trim(), so pointers
+    // from get() stay valid until the matching unpin().
+    void pin(std::size_t id) { ++at(id).pins; }
+    void unpin(std::size_t id) {
+        Entry& e = at(id);
+        if (e.pins) --e.pins;
+    }
+
+    // Visits every tree in id order, in batches that fit the budget next to
+    // what is already pinned. Each batch is loaded and pinned, passed to
+    // f(ids, trees), then unpinned and trimmed before the next one, so a
+    // scan over all trees never holds more than one batch at a time. A
+    // batch always takes at least one tree, even if that alone exceeds
+    // the budget.
+    template<typename F>
+    void forEachBatch(F f) {
+        std::vector<std::size_t> ids;
+        std::vector<NAryTree<T>*> trees;
+        auto release = [&] {
+            for (std::size_t id : ids) unpin(id);
+            ids.clear();
+            trees.clear();
+        };
+        try {
+            for (std::size_t i = 0; i < entries_.size(); ++i) {
+                if (!ids.empty() && residentBytes() + loadCost(i) > budget_) {
+                    f(ids, trees);
+                    release();
+                    trim();
+                }
+                trees.push_back(&get(i));
+                pin(i);
+                ids.push_back(i);
+                trim();
+            }
+            if (!ids.empty()) f(ids, trees);
+        } catch (...) {
+            release();
+            throw;
+        }
+        release();
+        trim();
+    }
+
+    // Makes room, oldest access first, until the resident trees fit the
+    // budget: dense trees are packed into implicit form, then trees are
+    // spilled to disk. Pinned trees and the most recently used one are
+    // left alone; references from get() to other trees must not be held
+    // across a trim().
+    void trim() {
+        std::size_t total = residentBytes();
+        if (total <= budget_) return;
+
+        std::vector<Entry*> order;
+        Entry* newest = nullptr;
+        for (auto& e : entries_) {
+            if (!e.tree && !e.compact) continue;
+            if (!newest || e.lastUse > newest->lastUse) newest = &e;
+            if (!e.pins) order.push_back(&e);
+        }
+        order.erase(std::remove(order.begin(), order.end(), newest), order.end());
+        std::sort(order.begin(), order.end(),
+                  [](const Entry* a, const Entry* b){ return a->lastUse < b->lastUse; });
+
+        for (Entry* e : order) {
+            if (total <= budget_) return;
+            if (!e->tree || !Adaptive::prefersImplicit(*e->tree)) continue;
+            total -= bytesOf(*e);
+            e->compact = std::make_unique<Adaptive>(std::move(*e->tree));
+            e->tree.reset();
+            total += bytesOf(*e);
+        }
+        for (Entry* e : order) {
+            if (total <= budget_) return;
+            total -= bytesOf(*e);
+            spill(*e);
+        }
+    }
+
+private:
+    using Adaptive = AdaptiveNAryTree<T>;
+
+    // At most one of tree/compact is set; neither while spilled.
+    struct Entry {
+        std::unique_ptr<NAryTree<T>> tree;
+        std::unique_ptr<Adaptive> compact;
+        std::string file;
+        std::size_t degree = 0;
+        bool background = false;
+        std::uint64_t lastUse = 0;
+        std::size_t nodes = 0;   // node count while spilled
+        std::size_t pins = 0;
+    };
+
+    static constexpr char kMagic[4] = {'N', 'A', 'T', '1'};
+
+    std::vector<Entry> entries_;
+    std::size_t budget_;
+    std::string dir_;
+    std::string tag_;
+    std::uint64_t clock_ = 0;
+    std::uint64_t files_ = 0;
+
+    Entry& at(std::size_t id) {
+        if (id >= entries_.size()) throw MyException(ErrorType::OutOfRange, 9);
+        return entries_[id];
+    }
+    const Entry& at(std::size_t id) const {
+        if (id >= entries_.size()) throw MyException(ErrorType::OutOfRange, 9);
+        return entries_[id];
+    }
+
+    static void fail() { throw MyException(ErrorType::Unknown, 11); }
+
+    // memoryStats() counts payload only. Each node is also two heap blocks
+    // (the Node and its child array), and malloc adds a header and rounds
+    // each one up, so about this much per block is added on top.
+    static constexpr std::size_t kBlockOverhead = 16;
+
+    // Estimated resident bytes of an NAryTree with this many nodes.
+    static std::size_t nodeBytes(std::size_t nodes, std::size_t degree) {
+        using Node = typename NAryTree<T>::Node;
+        return nodes * (sizeof(Node) + degree * sizeof(Node*) + 2 * kBlockOverhead);
+    }
+
+    static std::size_t bytesOf(const Entry& e) {
+        if (e.tree) return nodeBytes(e.tree->size(), e.degree);
+        if (e.compact) return e.compact->memoryBytes();
+        return 0;
+    }
+
+    template<typename V>
+    static void put(std::ostream& os, const V& v) {
+        os.write(reinterpret_cast<const char*>(&v), sizeof(V));
+    }
+    template<typename V>
+    static void take(std::istream& is, V& v) {
+        if (!is.read(reinterpret_cast<char*>(&v), sizeof(V))) fail();
+    }
+
+    void spill(Entry& e) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        std::string file = (std::filesystem::path(dir_) /
+                            ("tree_" + tag_ + "_" + std::to_string(files_++) + ".bin")).string();
+        {
+            std::ofstream os(file, std::ios::binary | std::ios::trunc);
+            if (!os) fail();
+            const std::size_t n = e.degree;
+            std::vector<unsigned char> mask((n + 7) / 8);
+            os.write(kMagic, sizeof(kMagic));
+            put(os, static_cast<std::uint64_t>(n));
+            e.nodes = e.tree ? e.tree->size() : e.compact->size();
+            put(os, static_cast<std::uint64_t>(e.nodes));
+            auto record = [&](const T& value, auto hasChild) {
+                std::fill(mask.begin(), mask.end(), 0);
+                for (std::size_t k = 0; k < n; ++k) {
+                    if (hasChild(k)) mask[k / 8] |= static_cast<unsigned char>(1u << (k % 8));
+                }
+                put(os, value);
+                os.write(reinterpret_cast<const char*>(mask.data()),
+                         static_cast<std::streamsize>(mask.size()));
+            };
+            if (e.tree) {
+                for (const auto& v : *e.tree) {
+                    record(v.node->value, [&](std::size_t k){ return v.node->children[k] != nullptr; });
+                }
+            } else {
+                e.compact->visitPreorder(record);
+            }
+            if (!os.flush()) {
+                os.close();
+                std::filesystem::remove(file, ec);
+                fail();
+            }
+        }
+        e.file = std::move(file);
+        e.tree.reset();
+        e.compact.reset();
+    }
+
+    void load(Entry& e) {
+        using Node = typename NAryTree<T>::Node;
+        std::ifstream is(e.file, std::ios::binary);
+        if (!is) fail();
+        char magic[sizeof(kMagic)];
+        std::uint64_t n = 0, count = 0;
+        if (!is.read(magic, sizeof(magic)) ||
+            !std::equal(magic, magic + sizeof(magic), kMagic)) fail();
+        take(is, n);
+        take(is, count);
+        if (n != e.degree) fail();
+
+        auto t = std::make_unique<NAryTree<T>>(e.degree);
+        t->setBackgroundReclaim(e.background);
+        // One mask per open level, all in a single buffer indexed by depth.
+        const std::size_t bytes = (e.degree + 7) / 8;
+        std::vector<unsigned char> masks;
+        auto record = [&](std::size_t depth) {
+            T value;
+            take(is, value);
+            if (masks.size() < (depth + 1) * bytes) masks.resize((depth + 1) * bytes);
+            if (!is.read(reinterpret_cast<char*>(masks.data() + depth * bytes),
+                         static_cast<std::streamsize>(bytes))) fail();
+            return value;
+        };
+        auto hasChild = [&](std::size_t depth, std::size_t k) {
+            return masks[depth * bytes + k / 8] & (1u << (k % 8));
+        };
+
+        struct Frame {
+            Node* node;
+            std::size_t next;
+        };
+        std::vector<Frame> stack;
+        if (count) {
+            t->insert({}, record(0));
+            stack.push_back({t->root(), 0});
+        }
+        while (!stack.empty()) {
+            const std::size_t depth = stack.size() - 1;
+            Frame& f = stack.back();
+            while (f.next < e.degree && !hasChild(depth, f.next)) ++f.next;
+            if (f.next == e.degree) {
+                stack.pop_back();
+                continue;
+            }
+            std::size_t k = f.next++;
+            Node* c = t->insertChild(f.node, depth, k, record(depth + 1));
+            stack.push_back({c, 0});
+        }
+        if (t->size() != count) fail();
+
+        is.close();
+        dropFile(e);
+        e.tree = std::move(t);
+    }
+
+    static void dropFile(Entry& e) {
+        std::error_code ec;
+        if (!e.file.empty()) std::filesystem::remove(e.file, ec);
+        e.file.clear();
+    }
+};
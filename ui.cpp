@@ -15,13 +15,13 @@ std::vector<std::size_t> parsePath(const std::string& s,char sep)
     return out;
 }
 
+// Widest value plus one space of padding; also the width of an "X" slot.
 template<typename T>
-static std::size_t maxWidth(const typename NAryTree<T>::Node* n)
+static std::size_t maxWidth(const NAryTree<T>& tr)
 {
-    if (!n) return 1;
-    std::size_t w = std::to_string(n->value).size();
-    for (auto* c : n->children) {
-        w = std::max<std::size_t>(w, maxWidth<T>(c));
+    std::size_t w = 1;
+    for (const auto& v : tr.preorderView()) {
+        w = std::max<std::size_t>(w, std::to_string(v.node->value).size());
     }
     return w + 1;
 }
@@ -38,7 +38,7 @@ void printTree(const NAryTree<T>& tr)
     const std::size_t h = tr.height();
     const std::size_t n = tr.degree();
 
-    const std::size_t lineW = maxWidth<T>(tr.root()) * (std::pow(n, h-1));
+    const std::size_t lineW = maxWidth(tr) * (std::pow(n, h-1));
 
     std::vector<N*> layer { tr.root() };
 
@@ -75,7 +75,18 @@ void printTree(const NAryTree<T>& tr)
     }
 }
 
-static int askID(const std::vector<NAryTree<int>*>& v,const char* prompt)
+static std::string pathToStr(const std::vector<std::size_t>& p)
+{
+    if (p.empty()) return "(root)";
+    std::string s;
+    for (std::size_t i = 0; i < p.size(); ++i) {
+        if (i) s.push_back('/');
+        s += std::to_string(p[i]);
+    }
+    return s;
+}
+
+static int askID(const TreeStore<int>& v,const char* prompt)
 {
     if(v.empty()) throw MyException(ErrorType::InvalidArg,10);
     std::cout<<prompt<<" [0.."<<v.size()-1<<"]: ";
@@ -87,17 +98,19 @@ static int askID(const std::vector<NAryTree<int>*>& v,const char* prompt)
     return id;
 }
 
-static void createTree(std::vector<NAryTree<int>*>& objs)
+static void createTree(TreeStore<int>& objs)
 {
     std::cout<<"Degree n=";
     int n; std::cin>>n;
     if(!std::cin||n<=0){ std::cin.clear(); std::cin.ignore(10000,'\n');
                          throw MyException(ErrorType::NegativeSize,2);}
-    objs.push_back(new NAryTree<int>(static_cast<std::size_t>(n)));
-    std::cout<<"Created tree #"<<objs.size()-1<<" (degree="<<n<<")\n";
+    auto tree = std::make_unique<NAryTree<int>>(static_cast<std::size_t>(n));
+    tree->setBackgroundReclaim(true);
+    std::size_t id = objs.add(std::move(tree));
+    std::cout<<"Created tree #"<<id<<" (degree="<<n<<")\n";
 }
 
-static void appendEl(std::vector<NAryTree<int>*>& objs)
+static void appendEl(TreeStore<int>& objs)
 {
     int id = askID(objs, "Tree id");
 
@@ -114,11 +127,11 @@ static void appendEl(std::vector<NAryTree<int>*>& objs)
     }
 
     auto path = parsePath(pathStr);
-    objs[id]->insert(path, val);
+    objs.get(id).insert(path, val);
     std::cout << "Inserted.\n";
 }
 
-static void removeEl(std::vector<NAryTree<int>*>& objs)
+static void removeEl(TreeStore<int>& objs)
 {
     int id=askID(objs,"Tree id");
     
@@ -128,116 +141,133 @@ static void removeEl(std::vector<NAryTree<int>*>& objs)
     std::getline(std::cin, pathStr);
 
     auto path = parsePath(pathStr);
-    objs[id]->smartErase(path);
+    objs.get(id).smartErase(path);
     std::cout<<"Deleted.\n";
 }
 
-static void printAll(const std::vector<NAryTree<int>*>& objs)
+template<typename T>
+static void printMemory(const NAryTree<T>& tr)
+{
+    auto m = tr.memoryStats();
+    std::cout<<"nodes="<<m.nodes<<", bytes="<<m.totalBytes
+             <<" (headers "<<m.headerBytes<<", child arrays "<<m.childBytes
+             <<", values "<<m.valueBytes<<"), null slots="<<m.nullSlots<<'\n';
+    if(m.levelFill.empty()) return;
+    std::cout<<"level fill:";
+    for(double f : m.levelFill) std::cout<<' '<<static_cast<int>(f*100+0.5)<<'%';
+    std::cout<<'\n';
+}
+
+static void printAll(TreeStore<int>& objs)
 {
     if(objs.empty()){ std::cout<<"<no trees>\n"; return; }
     for(std::size_t i=0; i<objs.size(); ++i){
-        std::cout<<"--- Tree #"<<i<<" (deg="<<objs[i]->degree()
-        <<", h=" << objs[i]->height() <<") ---\n";
-        printTree(*objs[i]);
+        const char* from = !objs.resident(i) ? ", reloaded from disk"
+                         : objs.compacted(i) ? ", unpacked from implicit form" : "";
+        const NAryTree<int>& tr = objs.get(i);
+        std::cout<<"--- Tree #"<<i<<" (deg="<<tr.degree()
+        <<", h=" << tr.height() <<from<<") ---\n";
+        printMemory(tr);
+        printTree(tr);
+        objs.trim();
     }
 }
 
-static void removeTree(std::vector<NAryTree<int>*>& objs)
+static void removeTree(TreeStore<int>& objs)
 {
     int id=askID(objs,"Tree id to delete");
-    delete objs[id];
-    objs.erase(objs.begin()+id);
+    objs.remove(id);
     std::cout<<"Tree removed.\n";
 }
 
-static void subTree(std::vector<NAryTree<int>*>& objs)
+static void subTree(TreeStore<int>& objs)
 {
     if(objs.size()<2) throw MyException(ErrorType::InvalidArg,10);
     int big=askID(objs,"Main tree id");
     int small=askID(objs,"Pattern tree id");
-    bool ok=objs[big]->containsSubtree(objs[small]->root());
+    const NAryTree<int>& tr=objs.get(big);
+    bool ok=tr.containsSubtree(objs.get(small).root());
     std::cout<<(ok?"Pattern found.\n":"Pattern NOT found.\n");
 }
 
-
-static int rndInt(int lo,int hi)
+static void batchSubTree(TreeStore<int>& objs)
 {
-    return rand() % (hi - lo + 1) + lo;
-}
-
-template<typename T>
-static void shuffle(std::vector<T>& v)
-{
-    for (std::size_t i = v.size(); i > 1; --i) {
-        std::size_t j = rand() % i;
-        std::swap(v[i-1], v[j]);
+    if(objs.empty()) throw MyException(ErrorType::InvalidArg,10);
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::cout<<"Pattern tree ids [0.."<<objs.size()-1<<"] (space separated): ";
+    std::string line;
+    std::getline(std::cin, line);
+
+    std::vector<std::size_t> ids;
+    std::stringstream ss(line); std::string tok;
+    while(ss>>tok){
+        for(char c:tok) if(!std::isdigit(c)) throw MyException(ErrorType::InvalidArg,0);
+        std::size_t id=std::stoull(tok);
+        if(id>=objs.size()) throw MyException(ErrorType::OutOfRange,9);
+        ids.push_back(id);
+    }
+    if(ids.empty()) throw MyException(ErrorType::InvalidArg,13);
+
+    // Patterns stay pinned for the whole scan; targets come in batches
+    // that fit the memory budget.
+    std::vector<const NAryTree<int>*> patterns;
+    try {
+        for(std::size_t id : ids){
+            patterns.push_back(&objs.get(id));
+            objs.pin(id);
+        }
+        objs.forEachBatch([&](const std::vector<std::size_t>& batch,
+                              const std::vector<NAryTree<int>*>& trees){
+            std::vector<const NAryTree<int>*> targets(trees.begin(), trees.end());
+            for(const auto& m : matchPatterns(patterns, targets)){
+                if(batch[m.tree]==ids[m.pattern]) continue;
+                std::cout<<"Pattern #"<<ids[m.pattern]<<" in tree #"<<batch[m.tree]
+                         <<" at "<<pathToStr(m.path)<<'\n';
+            }
+        });
+    } catch(...) {
+        for(std::size_t i=0; i<patterns.size(); ++i) objs.unpin(ids[i]);
+        throw;
     }
+    for(std::size_t id : ids) objs.unpin(id);
+    std::cout<<"Done.\n";
 }
 
-void createRandomTree(std::vector<NAryTree<int>*>& objs)
-{
-    srand(static_cast<unsigned>(time(nullptr)));
 
+void createRandomTree(TreeStore<int>& objs)
+{
     createTree(objs);
-    auto* tree = objs.back();
+    auto* tree = &objs.get(objs.size()-1);
 
     int H, pct, lo, hi;
+    unsigned long long seed;
     std::cout << "Target height (>=1): "; std::cin >> H;
     std::cout << "Fill percent  [0-100]: "; std::cin >> pct;
     std::cout << "Value range   [lo hi]: "; std::cin >> lo >> hi;
+    std::cout << "Seed (0 = random): "; std::cin >> seed;
     if(!std::cin || H<=0 || pct<0 || pct>100 || lo>hi) {
+        std::cin.clear(); std::cin.ignore(10000,'\n');
         throw MyException(ErrorType::InvalidArg,1);
     }
-        
-    tree->insert({}, rndInt(lo,hi));
-
-    const std::size_t n = tree->degree();
-    std::vector<std::vector<std::size_t>> parents = {{}};
-
-    for (int lvl=1; lvl<H && !parents.empty(); ++lvl)
-    {
-        std::vector<std::vector<std::size_t>> slots;
-        for (const auto& p : parents) {
-            for (std::size_t k=0;k<n;++k){
-                auto q=p; q.push_back(k);
-                slots.emplace_back(std::move(q));
-            }
-        }
-        std::size_t need = (slots.size()*pct + 50)/100;
-
-        shuffle(slots);
-        std::vector<std::vector<std::size_t>> nextParents;
-
-        for (std::size_t i=0; i<need; ++i) {
-            tree->insert(slots[i], rndInt(lo,hi));
-            nextParents.push_back(std::move(slots[i]));
-        }
-        parents.swap(nextParents);
+    if (!seed) {
+        seed = (static_cast<unsigned long long>(std::random_device{}()) << 32)
+             ^ static_cast<unsigned long long>(time(nullptr));
     }
 
+    fillRandomTree(*tree, {static_cast<std::size_t>(H), static_cast<unsigned>(pct), lo, hi, seed});
+
     std::cout << "Random tree created (height="
               << tree->height() << ", each level ≈ "
-              << pct << "% full)\n";
+              << pct << "% full, seed=" << seed << ")\n";
 }
 
 
-static std::string pathToStr(const std::vector<std::size_t>& p)
-{
-    if (p.empty()) return "(root)";
-    std::string s;
-    for (std::size_t i = 0; i < p.size(); ++i) {
-        if (i) s.push_back('/');
-        s += std::to_string(p[i]);
-    }
-    return s;
-}
-
-void findEl(std::vector<NAryTree<int>*>& objs) {
+void findEl(TreeStore<int>& objs) {
     if (objs.empty()) {
         throw MyException(ErrorType::InvalidArg, 10);
     }
     int id = askID(objs, "Tree id");
-    NAryTree<int>* tree = objs[id];
+    const NAryTree<int>* tree = &objs.get(id);
 
     std::cout << "Value to search: ";
     int target; std::cin >> target;
@@ -247,57 +277,59 @@ void findEl(std::vector<NAryTree<int>*>& objs) {
         throw MyException(ErrorType::InvalidArg, 1);
     }
 
-    std::cout << "Level h (1 = root): ";
-    int h;
-    std::cin >> h;
-    h--;
-    if (!std::cin || h < 0) {
+    std::cout << "Levels [from to] (1 = root): ";
+    int from, to;
+    std::cin >> from >> to;
+    if (!std::cin || from < 1 || to < 1) {
         std::cin.clear();
         std::cin.ignore(10000,'\n');
         throw MyException(ErrorType::InvalidArg, 1);
-        }
-
-    using Pair = std::pair<typename NAryTree<int>::Node*, std::vector<std::size_t>>;
-    std::queue<Pair> q;
-    q.push({tree->root(), {}});
-
-    std::vector<std::vector<std::size_t>> found;
-    int level = 0;
+    }
+    if (from > to) {
+        throw MyException(ErrorType::InvalidArg, 4);
+    }
 
-    while (!q.empty() && level <= h)
-    {
-        std::size_t sz = q.size();
-        while (sz--) {
-            auto [node, path] = q.front(); q.pop();
-            if (level == h && node && node->value == target)
-                found.push_back(path);
-
-            if (level < h && node) {
-                for (std::size_t k = 0; k < tree->degree(); ++k) {
-                    auto p = path; p.push_back(k);
-                    q.push({node->children[k], std::move(p)});
-                }
-            }
-        }
-        level++;
+    std::cout << "Max results (0 = all): ";
+    int limit;
+    std::cin >> limit;
+    if (!std::cin || limit < 0) {
+        std::cin.clear();
+        std::cin.ignore(10000,'\n');
+        throw MyException(ErrorType::InvalidArg, 1);
     }
 
-    if (found.empty()) {
-        std::cout << "No nodes == " << target << " at level " << h+1 << '\n';
+    bool first = true;
+    std::size_t hits = tree->search(
+        [&](int v){ return v == target; },
+        static_cast<std::size_t>(from - 1), static_cast<std::size_t>(to - 1),
+        [&](const NAryTree<int>::Visit& v){
+            std::cout << (first ? "Paths:\n" : "\n") << pathToStr(v.path)
+                      << " (level " << v.depth + 1 << ")" << std::flush;
+            first = false;
+        },
+        limit ? static_cast<std::size_t>(limit) : NAryTree<int>::npos);
+
+    if (!hits) {
+        std::cout << "No nodes == " << target << " at levels " << from << ".." << to << '\n';
     } else {
-        std::cout << "Paths:\n";
-        for (std::size_t i = 0; i < found.size(); ++i) {
-            if (i) std::cout << "\n";
-            std::cout << pathToStr(found[i]);
-        }
         std::cout << '\n';
     }
 }
 
 
+static void setBudget(TreeStore<int>& objs)
+{
+    std::cout<<"Memory budget in MiB (now "<<objs.budget()/(1024*1024)<<"): ";
+    long long mb; std::cin>>mb;
+    if(!std::cin||mb<0){ std::cin.clear(); std::cin.ignore(10000,'\n');
+                         throw MyException(ErrorType::InvalidArg,1);}
+    objs.setBudget(static_cast<std::size_t>(mb)*1024*1024);
+    std::cout<<"Budget set.\n";
+}
+
 void runUI()
 {
-    std::vector<NAryTree<int>*> objs;
+    TreeStore<int> objs(kDefaultBudget);
     bool run=true;
     while(run){
         try{
@@ -310,6 +342,8 @@ void runUI()
                      <<"6) Remove element\n"
                      <<"7) Create random tree\n"
                      <<"8) Find element\n"
+                     <<"9) Batch subtree search\n"
+                     <<"10) Set memory budget\n"
                      <<"0) Exit\nChoose: ";
             int cmd; std::cin>>cmd;
             if(!std::cin){ std::cin.clear(); std::cin.ignore(10000,'\n');
@@ -323,11 +357,13 @@ void runUI()
                 case 6: removeEl(objs);         break;
                 case 7: createRandomTree(objs); break;
                 case 8: findEl(objs);           break;
+                case 9: batchSubTree(objs);     break;
+                case 10: setBudget(objs);       break;
                 case 0: run=false;              break;
                 default: std::cout<<"Unknown command\n";
             }
+            objs.trim();
         }catch(const MyException& ex){ handleException(ex); }
     }
-    for(auto* t:objs) delete t;
     std::cout<<"Program finished.\n";
 }
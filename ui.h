@@ -1,8 +1,12 @@
 #pragma once
 #include "N-aryTree.hpp"
+#include "patternmatch.hpp"
+#include "generator.hpp"
+#include "treestore.hpp"
 #include "errors.hpp"
 #include <string>
 #include <vector>
+#include <memory>
 #include <queue>
 #include <sstream>
 #include <iostream>
@@ -10,13 +14,19 @@
 #include <cmath>
 #include <ctime>
 #include <cstdlib>
+#include <random>
 #include <queue> 
 
+// Resident tree memory runUI allows before packing or spilling trees to
+// ./tree_spill. It includes an estimate of malloc overhead per node, so
+// real usage stays close to it.
+constexpr std::size_t kDefaultBudget = 256u * 1024 * 1024;
+
 std::vector<std::size_t> parsePath(const std::string& s, char sep = '/');
 
-void createRandomTree(std::vector<NAryTree<int>*>& objs);
+void createRandomTree(TreeStore<int>& objs);
 
-void findEl(std::vector<NAryTree<int>*>& objs);
+void findEl(TreeStore<int>& objs);
 
 template<typename T>
 void printTree(const NAryTree<T>& tr);